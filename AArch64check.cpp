@@ -1,11 +1,21 @@
 #include "AArch64check.h"
 
+#if defined (__linux__) && defined (__aarch64__)
+#include <sys/auxv.h>
+#include <sys/utsname.h>
+#include <algorithm>
+#include <cstdio>
+#endif
+
 namespace {
     std::vector <std::map <std::uint16_t, std::uint64_t>> registers; // <register, value> [processor]
+    bool initialized = false; // any 'Initialize' was called
 }
 
 bool AArch64::Initialize () {
     bool result = false;
+    initialized = true;
+#ifdef _WIN32
 
     registers.clear ();
     registers.resize (GetActiveProcessorCount (ALL_PROCESSOR_GROUPS));
@@ -51,12 +61,15 @@ bool AArch64::Initialize () {
         } else
             break;
     }
-
+#else
+    registers.clear ();
+#endif
     return result;
 }
 
 bool AArch64::Initialize (const std::vector <std::map <std::uint16_t, std::uint64_t>> & data) {
     registers = data;
+    initialized = true;
     return true;
 }
 
@@ -88,13 +101,13 @@ std::vector <UINT> AArch64::HeterogeneitySets () {
     return sets;
 }
 
-bool AArch64::Check (UINT processor, Feature feature) noexcept {
-    if (processor < registers.size ()) {
+namespace {
+    bool Check (const std::map <std::uint16_t, std::uint64_t> & regmap, AArch64::Feature feature) noexcept {
         if (feature.raw == 0)
             return true;
 
-        auto i = registers [processor].find (feature.reg);
-        auto e = registers [processor].end ();
+        auto i = regmap.find (feature.reg);
+        auto e = regmap.end ();
 
         // this is very rough hack
         // some nibbles report 0b0000 as feature not present, but some 0b1111
@@ -105,6 +118,13 @@ bool AArch64::Check (UINT processor, Feature feature) noexcept {
             return nibble != 0xF
                 && nibble >= feature.minimum;
         }
+        return false;
+    }
+}
+
+bool AArch64::Check (UINT processor, Feature feature) noexcept {
+    if (processor < registers.size ()) {
+        return ::Check (registers [processor], feature);
     }
     return false;
 }
@@ -118,10 +138,10 @@ namespace {
         return false;
     }
 
-    bool ValidateLevel (const AArch64::Level & level, UINT processor, AArch64::Strictness strictness) {
+    bool ValidateLevel (const AArch64::Level & level, const std::map <std::uint16_t, std::uint64_t> & regmap, AArch64::Strictness strictness) {
         for (std::size_t s = 0; s != 1 + (std::size_t) strictness; ++s) {
             for (const auto & feature : level.features [s]) {
-                if (!Check (processor, feature))
+                if (!Check (regmap, feature))
                     return false;
             }
         }
@@ -135,25 +155,20 @@ namespace {
         }
         return {};
     }
-}
-
-WORD AArch64::Determine (UINT processor, Strictness strictness) noexcept {
 
-    // TODO: IsKnownSoC -> value
-
-    if (AnyRegisterData ()) {
+    WORD Determine (const std::map <std::uint16_t, std::uint64_t> & regmap, AArch64::Strictness strictness) noexcept {
         WORD match = 0x8'00;
 
-        for (const auto & level : Levels) {
-            if (!ValidateLevel (level, processor, strictness)) {
+        for (const auto & level : AArch64::Levels) {
+            if (!ValidateLevel (level, regmap, strictness)) {
 
                 // 8.5 can be 9.0, 8.6 can be 9.1, etc.
                 switch (match) {
-                    case 0x8'09: if (ValidateLevel (GetLevel (0x9'04), processor, strictness)) return 0x9'04; [[ fallthrough ]];
-                    case 0x8'08: if (ValidateLevel (GetLevel (0x9'03), processor, strictness)) return 0x9'03; [[ fallthrough ]];
-                    case 0x8'07: if (ValidateLevel (GetLevel (0x9'02), processor, strictness)) return 0x9'02; [[ fallthrough ]];
-                    case 0x8'06: if (ValidateLevel (GetLevel (0x9'01), processor, strictness)) return 0x9'01; [[ fallthrough ]];
-                    case 0x8'05: if (ValidateLevel (GetLevel (0x9'00), processor, strictness)) return 0x9'00;
+                    case 0x8'09: if (ValidateLevel (GetLevel (0x9'04), regmap, strictness)) return 0x9'04; [[ fallthrough ]];
+                    case 0x8'08: if (ValidateLevel (GetLevel (0x9'03), regmap, strictness)) return 0x9'03; [[ fallthrough ]];
+                    case 0x8'07: if (ValidateLevel (GetLevel (0x9'02), regmap, strictness)) return 0x9'02; [[ fallthrough ]];
+                    case 0x8'06: if (ValidateLevel (GetLevel (0x9'01), regmap, strictness)) return 0x9'01; [[ fallthrough ]];
+                    case 0x8'05: if (ValidateLevel (GetLevel (0x9'00), regmap, strictness)) return 0x9'00;
                 }
 
                 return match;
@@ -162,6 +177,437 @@ WORD AArch64::Determine (UINT processor, Strictness strictness) noexcept {
         }
 
         return match;
+    }
+}
+
+WORD AArch64::Determine (UINT processor, Strictness strictness) noexcept {
+
+    // TODO: IsKnownSoC -> value
+
+    if (AnyRegisterData ()) {
+        if (processor < registers.size ()) {
+            return ::Determine (registers [processor], strictness);
+        } else
+            return 0x8'00; // no data for this processor, no feature passes
     } else 
         return 0x000;
 }
+
+namespace {
+    bool HasRegisterData (UINT processor) {
+        return processor < registers.size ()
+            && !registers [processor].empty ();
+    }
+
+    // LoadRegisterData
+    //  - on Windows reads register data on first use, unless 'Initialize' was already called
+    //
+    bool LoadRegisterData (UINT processor) {
+#ifdef _WIN32
+        if (!initialized) {
+            AArch64::Initialize ();
+        }
+#endif
+        return HasRegisterData (processor);
+    }
+
+    // Infer
+    //  - higher values of the same register field imply lower ones, so e.g. OS reporting SHA512
+    //    also answers SHA256, and OS reporting missing LRCPC also answers LRCPC2
+    //  - 'state' returns 1 for flag set, 0 for flag off that proves absence, -1 for flag off
+    //    that doesn't: flags combining several fields (e.g. CRYPTO) only mean that not all of them
+    //    are present, and OS versions that predate a flag report it off regardless of hardware
+    //
+    template <typename T, std::size_t N, typename P>
+    int Infer (const T (&table) [N], AArch64::Feature feature, P state) {
+        int result = -1;
+        for (const auto & entry : table) {
+            if (entry.feature.reg == feature.reg && entry.feature.offset == feature.offset) {
+                switch (state (entry)) {
+                    case 1:
+                        if (entry.feature.minimum >= feature.minimum)
+                            return 1;
+                        break;
+                    case 0:
+                        if (entry.feature.minimum <= feature.minimum) {
+                            result = 0;
+                        }
+                        break;
+                }
+            }
+        }
+        return result;
+    }
+
+#if defined (_M_ARM64)
+    // OSBuild
+    //  - RtlGetVersion isn't subject to compatibility manifest like GetVersionEx
+    //
+    DWORD OSBuild () {
+        static const DWORD build = [] {
+            RTL_OSVERSIONINFOW info = {};
+            info.dwOSVersionInfoSize = sizeof info;
+
+            if (auto pRtlGetVersion = reinterpret_cast <LONG (WINAPI *) (PRTL_OSVERSIONINFOW)> (GetProcAddress (GetModuleHandleW (L"NTDLL"), "RtlGetVersion"))) {
+                if (pRtlGetVersion (&info) == 0)
+                    return info.dwBuildNumber;
+            }
+            return DWORD (0);
+        } ();
+        return build;
+    }
+
+    // minimal builds are conservative, older builds might report the flag, but answer only presence
+
+    const struct {
+        AArch64::Feature feature;
+        DWORD            code;
+        bool             exclusive; // the flag reports only this register field
+        DWORD            since;     // first OS build that reports the flag
+    } pfs [] = {
+        { AArch64::Features::AES,     PF_ARM_V8_CRYPTO_INSTRUCTIONS_AVAILABLE,   false, 0 },
+        { AArch64::Features::SHA1,    PF_ARM_V8_CRYPTO_INSTRUCTIONS_AVAILABLE,   false, 0 },
+        { AArch64::Features::SHA256,  PF_ARM_V8_CRYPTO_INSTRUCTIONS_AVAILABLE,   false, 0 },
+        { AArch64::Features::CRC32,   PF_ARM_V8_CRC32_INSTRUCTIONS_AVAILABLE,    true,  0 },
+        { AArch64::Features::LSE,     PF_ARM_V81_ATOMIC_INSTRUCTIONS_AVAILABLE,  true,  17763 },
+        { AArch64::Features::DotProd, PF_ARM_V82_DP_INSTRUCTIONS_AVAILABLE,      true,  22621 },
+        { AArch64::Features::JSCVT,   PF_ARM_V83_JSCVT_INSTRUCTIONS_AVAILABLE,   true,  22621 },
+        { AArch64::Features::LRCPC,   PF_ARM_V83_LRCPC_INSTRUCTIONS_AVAILABLE,   true,  22621 },
+        { AArch64::Features::SVE,     PF_ARM_SVE_INSTRUCTIONS_AVAILABLE,         true,  26100 },
+    };
+
+    int DefaultFeatureSource (AArch64::Feature feature) {
+        return Infer (pfs, feature, [] (const auto & pf) {
+            if (IsProcessorFeaturePresent (pf.code))
+                return 1;
+            else
+                return (pf.exclusive && OSBuild () >= pf.since) ? 0 : -1;
+        });
+    }
+#elif defined (__linux__) && defined (__aarch64__)
+    // KernelVersion
+    //  - e.g. 0x05'0A for 5.10, zero if unknown
+    //
+    unsigned int KernelVersion () {
+        static const unsigned int version = [] {
+            struct utsname name;
+            unsigned int major = 0;
+            unsigned int minor = 0;
+            if (uname (&name) == 0 && std::sscanf (name.release, "%u.%u", &major, &minor) == 2)
+                return (major << 8) | std::min (minor, 0xFFu);
+            else
+                return 0u;
+        } ();
+        return version;
+    }
+
+    // values from Linux arch/arm64/include/uapi/asm/hwcap.h
+    //  - minimal kernel versions are conservative, older kernels (also without AT_HWCAP2 at all)
+    //    report zero for bits they don't know, so those answer only presence
+
+    const struct {
+        AArch64::Feature feature;
+        unsigned long    type; // AT_HWCAP or AT_HWCAP2
+        unsigned long    bit;
+        unsigned int     since; // first kernel version that reports the bit
+    } hwcaps [] = {
+        { AArch64::Features::AES,     AT_HWCAP, 1uL << 3,  0x03'0E },
+        { AArch64::Features::PMULL,   AT_HWCAP, 1uL << 4,  0x03'0E },
+        { AArch64::Features::SHA1,    AT_HWCAP, 1uL << 5,  0x03'0E },
+        { AArch64::Features::SHA256,  AT_HWCAP, 1uL << 6,  0x03'0E },
+        { AArch64::Features::CRC32,   AT_HWCAP, 1uL << 7,  0x03'0E },
+        { AArch64::Features::LSE,     AT_HWCAP, 1uL << 8,  0x04'03 },
+        { AArch64::Features::FP16,    AT_HWCAP, 1uL << 10, 0x04'0B }, // ASIMDHP
+        { AArch64::Features::RDM,     AT_HWCAP, 1uL << 12, 0x04'0F },
+        { AArch64::Features::JSCVT,   AT_HWCAP, 1uL << 13, 0x04'0C },
+        { AArch64::Features::FCMA,    AT_HWCAP, 1uL << 14, 0x04'0C },
+        { AArch64::Features::LRCPC,   AT_HWCAP, 1uL << 15, 0x04'0C },
+        { AArch64::Features::DPB,     AT_HWCAP, 1uL << 16, 0x04'0E },
+        { AArch64::Features::SHA3,    AT_HWCAP, 1uL << 17, 0x04'0F },
+        { AArch64::Features::SM3,     AT_HWCAP, 1uL << 18, 0x04'0F },
+        { AArch64::Features::SM4,     AT_HWCAP, 1uL << 19, 0x04'0F },
+        { AArch64::Features::DotProd, AT_HWCAP, 1uL << 20, 0x04'0F },
+        { AArch64::Features::SHA512,  AT_HWCAP, 1uL << 21, 0x04'0F },
+        { AArch64::Features::SVE,     AT_HWCAP, 1uL << 22, 0x04'0F },
+        { AArch64::Features::FHM,     AT_HWCAP, 1uL << 23, 0x04'11 },
+        { AArch64::Features::DIT,     AT_HWCAP, 1uL << 24, 0x04'11 },
+        { AArch64::Features::LSE2,    AT_HWCAP, 1uL << 25, 0x04'11 }, // USCAT
+        { AArch64::Features::LRCPC2,  AT_HWCAP, 1uL << 26, 0x04'11 }, // ILRCPC
+        { AArch64::Features::FlagM,   AT_HWCAP, 1uL << 27, 0x04'11 },
+        { AArch64::Features::SB,      AT_HWCAP, 1uL << 29, 0x05'00 },
+        { AArch64::Features::DPB2,    AT_HWCAP2, 1uL << 0,  0x05'03 },
+        { AArch64::Features::FlagM2,  AT_HWCAP2, 1uL << 7,  0x05'04 },
+        { AArch64::Features::FRINTTS, AT_HWCAP2, 1uL << 8,  0x05'04 },
+        { AArch64::Features::I8MM,    AT_HWCAP2, 1uL << 13, 0x05'0A },
+        { AArch64::Features::BF16,    AT_HWCAP2, 1uL << 14, 0x05'0A },
+        { AArch64::Features::RNG,     AT_HWCAP2, 1uL << 16, 0x05'06 },
+        { AArch64::Features::BTI,     AT_HWCAP2, 1uL << 17, 0x05'08 },
+        { AArch64::Features::MTE2,    AT_HWCAP2, 1uL << 18, 0x05'0A },
+        { AArch64::Features::ECV,     AT_HWCAP2, 1uL << 19, 0x05'11 },
+    };
+
+    int DefaultFeatureSource (AArch64::Feature feature) {
+        return Infer (hwcaps, feature, [] (const auto & hwcap) {
+            if (getauxval (hwcap.type) & hwcap.bit)
+                return 1;
+            else
+                return (KernelVersion () >= hwcap.since) ? 0 : -1;
+        });
+    }
+#else
+    // x64 build (running emulated) or unknown OS, PF_ARM_XXX flags are not reported
+
+    int DefaultFeatureSource (AArch64::Feature) {
+        return -1;
+    }
+#endif
+
+    AArch64::FeatureSource source = DefaultFeatureSource;
+}
+
+void AArch64::SetFeatureSource (FeatureSource replacement) noexcept {
+    source = replacement ? replacement : DefaultFeatureSource;
+}
+
+AArch64::Resolution AArch64::Resolve (UINT processor, Feature feature) noexcept {
+    Resolution resolution = { false, Tier::None, false };
+
+    if (feature.raw == 0) // Features::Null always checks true
+        return { true, Tier::System, false };
+
+    switch (source (feature)) {
+        case 1:
+            resolution.result = true;
+            [[ fallthrough ]];
+        case 0:
+            resolution.tier = Tier::System;
+            if (HasRegisterData (processor)) {
+                resolution.conflict = Check (processor, feature) != resolution.result;
+            }
+            break;
+
+        default:
+            if (LoadRegisterData (processor)) {
+                resolution.result = Check (processor, feature);
+                resolution.tier = Tier::Registers;
+            }
+    }
+    return resolution;
+}
+
+AArch64::Resolution AArch64::Resolve (UINT processor, WORD level, Strictness strictness) noexcept {
+    Resolution resolution = { false, Tier::None, false };
+
+    if (GetLevel (level).name == level) {
+
+        // levels that 'Determine' must pass to return at least 'level'
+        //  - 8.5 can be promoted to 9.0, thus 8.6+ requires only up to 8.5, 9.1 requires up to 8.6, etc.
+
+        const WORD necessary = (level >= 0x9'00) ? WORD (0x8'05 + (level & 0xFF))
+                             : (level >= 0x8'05) ? WORD (0x8'05)
+                             : level;
+        bool absent = false;
+        bool unknown = false;
+
+        for (const auto & l : Levels) {
+            if (l.name > level)
+                break;
+
+            for (std::size_t s = 0; s != 1 + (std::size_t) strictness; ++s) {
+                for (const auto & feature : l.features [s]) {
+                    if (feature.raw != 0) {
+                        switch (source (feature)) {
+                            case 1:
+                                break;
+                            case 0:
+                                if (l.name <= necessary) {
+                                    absent = true;
+                                    break;
+                                }
+                                [[ fallthrough ]];
+                            default:
+                                unknown = true;
+                        }
+                    }
+                }
+            }
+        }
+
+        if (absent || !unknown) {
+            resolution.result = !absent;
+            resolution.tier = Tier::System;
+        }
+    }
+
+    if ((resolution.tier == Tier::System) ? HasRegisterData (processor) : LoadRegisterData (processor)) {
+        bool result = Determine (processor, strictness) >= level;
+
+        if (resolution.tier == Tier::System) {
+            resolution.conflict = resolution.result != result;
+        } else {
+            resolution.result = result;
+            resolution.tier = Tier::Registers;
+        }
+    }
+    return resolution;
+}
+
+namespace {
+    // SWAR helpers, process all 16 nibbles of an ID register at once
+
+    constexpr std::uint64_t Nibbles0 = 0x1111'1111'1111'1111; // lowest bit of each nibble
+    constexpr std::uint64_t Bytes0F = 0x0F0F'0F0F'0F0F'0F0F;
+    constexpr std::uint64_t Bytes80 = 0x8080'8080'8080'8080;
+
+    // NibblesAbsent
+    //  - returns 0xF in nibbles of 'x' that are 0xF (feature absent for 'Check')
+    //
+    std::uint64_t NibblesAbsent (std::uint64_t x) noexcept {
+        x &= x >> 1;
+        x &= x >> 2;
+        return (x & Nibbles0) * 0xF;
+    }
+
+    // NibblesDifferent
+    //  - returns 0xF in nibbles where 'a' and 'b' differ
+    //
+    std::uint64_t NibblesDifferent (std::uint64_t a, std::uint64_t b) noexcept {
+        auto x = a ^ b;
+        x |= x >> 1;
+        x |= x >> 2;
+        return (x & Nibbles0) * 0xF;
+    }
+
+    // BytesMin
+    //  - lower value in each byte, all bytes must be 0..15
+    //
+    std::uint64_t BytesMin (std::uint64_t a, std::uint64_t b) noexcept {
+        auto ge = ((a | Bytes80) - b) & Bytes80; // high bit set where a >= b, no borrows as all bytes are 0..15
+        auto mask = (ge >> 7) * 0xFF;
+        return (b & mask) | (a & ~mask);
+    }
+
+    // NibblesMin
+    //  - lower value in each nibble, computed separately for even and odd nibbles spread to bytes
+    //
+    std::uint64_t NibblesMin (std::uint64_t a, std::uint64_t b) noexcept {
+        return BytesMin (a & Bytes0F, b & Bytes0F)
+             | BytesMin ((a >> 4) & Bytes0F, (b >> 4) & Bytes0F) << 4;
+    }
+
+    // BytesMax, NibblesMax
+    //  - higher value in each byte/nibble, same as above
+    //
+    std::uint64_t BytesMax (std::uint64_t a, std::uint64_t b) noexcept {
+        auto ge = ((a | Bytes80) - b) & Bytes80;
+        auto mask = (ge >> 7) * 0xFF;
+        return (a & mask) | (b & ~mask);
+    }
+    std::uint64_t NibblesMax (std::uint64_t a, std::uint64_t b) noexcept {
+        return BytesMax (a & Bytes0F, b & Bytes0F)
+             | BytesMax ((a >> 4) & Bytes0F, (b >> 4) & Bytes0F) << 4;
+    }
+
+    // ID_AA64PFR0_EL1 (0x4020) .. ID_AA64MMFR7_EL1 (0x403F)
+
+    constexpr std::uint16_t FeatureRegistersBase = 0x4020;
+    constexpr std::size_t FeatureRegistersCount = 0x20;
+
+    bool IsFeatureRegister (std::uint16_t id) noexcept {
+        return id >= FeatureRegistersBase
+            && id < FeatureRegistersBase + FeatureRegistersCount;
+    }
+}
+
+AArch64::Intersection AArch64::Intersect () {
+    Intersection result = {};
+
+    std::set <std::map <std::uint16_t, std::uint64_t>> uniques;
+    UINT processor = 0;
+    for (const auto & regmap : registers) {
+        if (uniques.insert (regmap).second) {
+            result.classes.push_back (processor);
+        }
+        ++processor;
+    }
+
+    if (!result.classes.empty ()) {
+        // single pass over class representatives, each folds all its ID registers at once into slots
+        //  - best: highest value among classes, ignoring 0xF (absent) unless absent in all classes,
+        //          so features passing on 'best' but not on 'common' are present only on some classes
+
+        struct {
+            std::uint64_t first;
+            std::uint64_t common;
+            std::uint64_t best;
+            std::uint64_t differences;
+            std::size_t   reported; // by number of classes
+        } slots [FeatureRegistersCount] = {};
+
+        for (std::size_t i = 0; i != result.classes.size (); ++i) {
+            std::uint64_t values [FeatureRegistersCount];
+            for (auto & value : values) {
+                value = ~std::uint64_t (0); // missing register reads as all absent
+            }
+            for (const auto & [id, value] : registers [result.classes [i]]) {
+                if (IsFeatureRegister (id)) {
+                    values [id - FeatureRegistersBase] = value;
+                    slots [id - FeatureRegistersBase].reported++;
+                }
+            }
+
+            for (std::size_t r = 0; r != FeatureRegistersCount; ++r) {
+                auto & slot = slots [r];
+                auto value = values [r];
+
+                if (i == 0) {
+                    slot.first = value;
+                    slot.common = value;
+                    slot.best = value;
+                } else {
+                    auto absent = NibblesAbsent (value);
+                    auto absent_best = NibblesAbsent (slot.best);
+
+                    slot.differences |= NibblesDifferent (slot.first, value);
+                    slot.common = NibblesMin (slot.common, value) | NibblesAbsent (slot.common) | absent;
+                    slot.best = NibblesMax (slot.best & ~absent_best, value & ~absent) | (absent_best & absent);
+                }
+            }
+        }
+
+        std::map <std::uint16_t, std::uint64_t> best;
+        for (std::size_t r = 0; r != FeatureRegistersCount; ++r) {
+            const auto id = std::uint16_t (FeatureRegistersBase + r);
+            const auto & slot = slots [r];
+
+            if (slot.reported == result.classes.size ()) {
+                result.common [id] = slot.common;
+            }
+            if (slot.reported) {
+                best [id] = slot.best;
+            }
+            if (slot.differences) {
+                result.differences [id] = slot.differences;
+            }
+        }
+
+        // level is determined from the common registers, not as the lowest of class levels,
+        // because e.g. v9.0 promoted from v8.5 is not superset of v8.6
+
+        if (AnyRegisterData ()) {
+            for (std::size_t s = 0; s != (std::size_t) Strictness::Count; ++s) {
+                result.level [s] = ::Determine (result.common, (Strictness) s);
+            }
+        }
+
+        for (const auto & feature : Features::All) {
+            if (::Check (result.common, feature)) {
+                result.features.push_back (feature);
+            } else
+            if (::Check (best, feature)) {
+                result.partial.push_back (feature);
+            }
+        }
+    }
+    return result;
+}
@@ -1,13 +1,31 @@
 #ifndef AARCH64CHECK_H
 #define AARCH64CHECK_H
 
+#ifdef _WIN32
 #include <Windows.h>
+#endif
 #include <cstdint>
 #include <vector>
 #include <span>
 #include <map>
 #include <set>
 
+#ifndef _WIN32
+// minimal subset of Windows types, so that the matching engine can be built and exercised
+// elsewhere (e.g. Linux) on alternative datasets passed to 'Initialize (dataset)'
+
+typedef std::uint8_t BYTE;
+typedef std::uint16_t WORD;
+typedef std::uint32_t DWORD;
+typedef unsigned int UINT;
+
+typedef struct _PROCESSOR_NUMBER {
+    WORD Group;
+    BYTE Number;
+    BYTE Reserved;
+} PROCESSOR_NUMBER;
+#endif
+
 namespace AArch64 {
     namespace Register {
         static constexpr WORD MIDR_EL1 = 0x4000;
@@ -58,6 +76,9 @@ namespace AArch64 {
     };
 
     namespace Features {
+        // NOTE: every feature added below must also be added to 'All' at the end of this namespace,
+        //       otherwise it's left out of 'Intersect' results and the fuzzing harness coverage
+
         static constexpr Feature Null = { 0,0,0 }; // identity feature to simplify spans below, always check true
 
         static constexpr Feature AES    = { Register::ID_AA64ISAR0_EL1, 4,  1, "AES" };
@@ -193,6 +214,29 @@ namespace AArch64 {
         static constexpr Feature Debugv8p8 = { Register::ID_AA64DFR0_EL1, 0, 0b1010, "Debugv8.8" };
         static constexpr Feature Debugv8p9 = { Register::ID_AA64DFR0_EL1, 0, 0b1011, "Debugv8.9" };
 
+        // all named features above, for enumeration, keep in sync with the declarations
+        static constexpr Feature All [] = {
+            AES, PMULL, SHA1, SHA256, SHA512, CRC32, LSE, LSE128,
+            TME, RDM, SHA3, SM3, SM4, DotProd, FHM, FlagM,
+            FlagM2, TLBIOS, TLBIRANGE, RNG,
+            DPB, DPB2, PAuth, EPAC, PAuth2, FPAC, FPACCOMBINE, PAuth_LR,
+            JSCVT, FCMA, LRCPC, LRCPC2, LRCPC3, PACQARMA5, PACIMP, FRINTTS,
+            SB, SPECRES, SPECRES2, BF16, EBF16, DGH, I8MM, XS,
+            LS64, LS64_V, LS64_ACCDATA, LS64WB,
+            WFxT, MOPS, HBC, CLRBHB, CSSC, CMPBR,
+            FGT, FGT2, ECV,
+            VHE, HPDS, HPDS2, LOR, PAN, PAN2, PAN3, XNX,
+            ETS2, ETS3, TIDCP1, CMOW, ECBHB,
+            TTCNP, UAO, LSMAOC, IESB, LVA, LVA3, CCIDX, NV,
+            NV2, TTST, LSE2, IDST, IDTE3, S2FWB, TTL, BBM,
+            BBM_L2, E0PD,
+            TCR2, SCTLR2,
+            FP16, RAS, RASv1p1, RASv2, SVE, SEL2, AMUv1, AMUv1p1,
+            DIT, CSV2, CSV2_2, CSV2_3, CSV3,
+            BTI, SSBS, SSBS2, MTE, MTE2, MTE3, SME, SME2,
+            RNDS, NMI, GCS, THE, DoubleFault2, PFAR,
+            Debugv8p1, Debugv8p2, Debugv8p4, Debugv8p8, Debugv8p9,
+        };
     }
     namespace Sets {
         // TODO: Completely re-calibrate (only up to v8.3 is somewhat calibrated):
@@ -302,6 +346,7 @@ namespace AArch64 {
 
     // Initialize
     //  - reads local device data and initializes working dataset
+    //  - on other platforms than Windows always returns false; use 'Initialize (dataset)'
     //
     bool Initialize ();
 
@@ -347,6 +392,72 @@ namespace AArch64 {
     //             0x905 - for ARMv9.5
     //
     WORD Determine (UINT processor, Strictness = Strictness::Relaxed) noexcept;
+
+    // FeatureSource
+    //  - OS-provided feature query, cheap compared to reading and matching full register data
+    //  - returns: 1 - feature is present
+    //             0 - feature is not present
+    //             -1 - OS doesn't report this feature (or anything that would imply its value)
+    //  - the default uses IsProcessorFeaturePresent on Windows and HWCAPs on Linux (both ARM64 builds only)
+    //
+    typedef int (* FeatureSource) (Feature);
+
+    // SetFeatureSource
+    //  - replaces the OS feature query, e.g. with a mock for testing; nullptr restores the default
+    //
+    void SetFeatureSource (FeatureSource) noexcept;
+
+    // Tier
+    //  - which source answered the 'Resolve' query
+    //
+    enum class Tier {
+        None,      // neither source is able to decide (no register data), the result is 'false'
+        System,    // answered from OS-provided feature flags
+        Registers, // answered from full register data (as 'Check' or 'Determine')
+    };
+
+    struct Resolution {
+        bool result;
+        Tier tier;
+        bool conflict; // OS feature flags and register data are both available and disagree
+    };
+
+    // Resolve (feature)
+    //  - checks presence of a 'feature', from OS feature flags if possible, falls back to 'Check'
+    //  - no need to call 'Initialize' first: when the flags can't decide, on Windows the register
+    //    data are read on first use, elsewhere 'Tier::None' is returned and the caller can provide
+    //    them through 'Initialize (dataset)' and retry
+    //  - register data, if already loaded, are used to cross-check the OS flags ('conflict')
+    //
+    Resolution Resolve (UINT processor, Feature) noexcept;
+
+    // Resolve (level)
+    //  - checks whether 'Determine' would return at least 'level' (e.g. 0x08'03), if OS feature flags
+    //    are enough to decide that (usually only negative answer), they are used, otherwise falls back
+    //    to 'Determine', register data are obtained the same way as above
+    //
+    Resolution Resolve (UINT processor, WORD level, Strictness = Strictness::Relaxed) noexcept;
+
+    struct Intersection {
+        std::vector <UINT> classes; // first processor of each distinct feature set (heterogeneity class)
+        WORD level [(std::size_t) Strictness::Count]; // 'Determine' result on 'common' registers, per strictness
+
+        // ID_AA64xxx registers
+        //  - common: each nibble is the lowest value among classes, or 0xF if any class reports 0xF,
+        //            registers missing from any class are left out
+        //  - differences: nibbles set to 0xF where the value differs between any two classes
+        std::map <std::uint16_t, std::uint64_t> common;
+        std::map <std::uint16_t, std::uint64_t> differences;
+
+        std::vector <Feature> features; // from 'Features::All', present on every class
+        std::vector <Feature> partial;  // from 'Features::All', present only on some classes
+    };
+
+    // Intersect
+    //  - computes ISA level and features safe to use on every logical processor (threads can migrate),
+    //    and which ID register fields and named features differ between heterogeneity classes
+    //
+    Intersection Intersect ();
 }
 
 #endif
@@ -0,0 +1,489 @@
+// AArch64fuzz
+//  - differential harness for the feature-matching engine, builds on Linux (see Makefile)
+//  - generates random and boundary-value register datasets, evaluates them through the engine
+//    and through the independent reference below, stops on the first divergence and prints
+//    minimized dataset as a snapshot, ready to paste into win32-arm64-arch-check.cpp
+//  - usage: AArch64fuzz [datasets] [seed]
+//
+// the engine translation unit is included directly, so that internal helpers can be compared too
+
+#include "../AArch64check.cpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+
+namespace {
+    typedef std::map <std::uint16_t, std::uint64_t> Regs;
+    typedef std::vector <Regs> Dataset;
+
+    const std::uint16_t ids [] = {
+        AArch64::Register::MIDR_EL1,
+        AArch64::Register::ID_AA64PFR0_EL1, AArch64::Register::ID_AA64PFR1_EL1,
+        AArch64::Register::ID_AA64DFR0_EL1, AArch64::Register::ID_AA64DFR1_EL1,
+        AArch64::Register::ID_AA64ISAR0_EL1, AArch64::Register::ID_AA64ISAR1_EL1, AArch64::Register::ID_AA64ISAR2_EL1,
+        AArch64::Register::ID_AA64MMFR0_EL1, AArch64::Register::ID_AA64MMFR1_EL1,
+        AArch64::Register::ID_AA64MMFR2_EL1, AArch64::Register::ID_AA64MMFR3_EL1,
+        AArch64::Register::SCTLR_EL1,
+    };
+
+    // Reference
+    //  - straightforward restatement of the matching rules, written independently of the engine
+
+    namespace Reference {
+        bool Check (const Dataset & data, UINT processor, AArch64::Feature feature) {
+            if (processor >= data.size ())
+                return false;
+            if (feature.reg == 0 && feature.offset == 0 && feature.minimum == 0) // Features::Null
+                return true;
+
+            auto r = data [processor].find (feature.reg);
+            if (r == data [processor].end ())
+                return false;
+
+            auto nibble = unsigned ((r->second / (std::uint64_t (1) << feature.offset)) % 16);
+            if (nibble == 15) // 0xF means absent
+                return false;
+
+            return nibble >= feature.minimum;
+        }
+
+        const AArch64::Level * Find (WORD name) {
+            for (const auto & level : AArch64::Levels) {
+                if (level.name == name)
+                    return &level;
+            }
+            return nullptr;
+        }
+
+        bool Validate (const Dataset & data, UINT processor, const AArch64::Level & level, AArch64::Strictness strictness) {
+            for (std::size_t s = 0; s <= (std::size_t) strictness; ++s) {
+                for (const auto & feature : level.features [s]) {
+                    if (!Check (data, processor, feature))
+                        return false;
+                }
+            }
+            return true;
+        }
+
+        bool Any (const Dataset & data) {
+            for (const auto & regs : data) {
+                if (!regs.empty ())
+                    return true;
+            }
+            return false;
+        }
+
+        // Match
+        //  - level of 'processor', assuming there is some register data
+        //
+        WORD Match (const Dataset & data, UINT processor, AArch64::Strictness strictness) {
+            WORD match = 0x800;
+            for (const auto & level : AArch64::Levels) {
+                if (!Validate (data, processor, level, strictness)) {
+
+                    // promotion chain: v8.(5+N) or better can be v9.N, highest applicable wins
+                    if (match >= 0x805 && match <= 0x809) {
+                        for (WORD v = 0x900 + (match - 0x805); v >= 0x900; --v) {
+                            if (Validate (data, processor, *Find (v), strictness))
+                                return v;
+                        }
+                    }
+                    return match;
+                }
+                match = level.name;
+            }
+            return match;
+        }
+
+        WORD Determine (const Dataset & data, UINT processor, AArch64::Strictness strictness) {
+            return Any (data) ? Match (data, processor, strictness) : 0;
+        }
+
+        // Common
+        //  - ID registers present on all processors, each nibble lowest, or 0xF where any has 0xF
+        //
+        Regs Common (const Dataset & data) {
+            Regs common;
+            for (std::uint16_t id = 0x4020; id <= 0x403F; ++id) {
+                bool everywhere = !data.empty ();
+                for (const auto & regs : data) {
+                    everywhere &= regs.count (id) != 0;
+                }
+                if (everywhere) {
+                    std::uint64_t value = 0;
+                    for (auto n = 0u; n != 16; ++n) {
+                        unsigned lowest = 0xF;
+                        bool absent = false;
+                        for (const auto & regs : data) {
+                            unsigned nibble = (regs.at (id) >> (4 * n)) & 0xF;
+                            absent |= (nibble == 0xF);
+                            lowest = std::min (lowest, nibble);
+                        }
+                        value |= std::uint64_t (absent ? 0xF : lowest) << (4 * n);
+                    }
+                    common [id] = value;
+                }
+            }
+            return common;
+        }
+
+        // Differences
+        //  - 0xF in nibbles of ID registers that differ between any processors, missing register reads as 0xF
+        //
+        Regs Differences (const Dataset & data) {
+            Regs differences;
+            for (std::uint16_t id = 0x4020; id <= 0x403F; ++id) {
+                std::uint64_t mask = 0;
+                for (auto n = 0u; n != 16; ++n) {
+                    std::set <unsigned> values;
+                    for (const auto & regs : data) {
+                        auto r = regs.find (id);
+                        values.insert ((r != regs.end ()) ? unsigned ((r->second >> (4 * n)) & 0xF) : 0xF);
+                    }
+                    if (values.size () > 1) {
+                        mask |= std::uint64_t (0xF) << (4 * n);
+                    }
+                }
+                if (mask) {
+                    differences [id] = mask;
+                }
+            }
+            return differences;
+        }
+    }
+
+    // Raise
+    //  - sets register field to the feature's minimum, unless already higher
+    //
+    void Raise (Regs & regs, AArch64::Feature feature) {
+        if (feature.raw != 0) {
+            auto & value = regs [feature.reg];
+            auto nibble = (value >> feature.offset) & 0xF;
+            if (nibble == 0xF || nibble < feature.minimum) {
+                value &= ~(std::uint64_t (0xF) << feature.offset);
+                value |= std::uint64_t (feature.minimum) << feature.offset;
+            }
+        }
+    }
+
+    Regs Satisfying (std::initializer_list <WORD> names) {
+        Regs regs;
+        for (auto name : names) {
+            for (const auto & features : Reference::Find (name)->features) {
+                for (const auto & feature : features) {
+                    Raise (regs, feature);
+                }
+            }
+        }
+        return regs;
+    }
+
+    // Generator
+
+    class Generator {
+        std::mt19937_64 rng;
+
+        std::uint64_t Pick (std::uint64_t n) { return rng () % n; }
+
+        // Nibble
+        //  - boundary values are heavily favored
+        //
+        std::uint64_t Nibble () {
+            static const std::uint64_t boundary [] = { 0x0, 0x1, 0x2, 0x3, 0x7, 0x8, 0x9, 0xA, 0xB, 0xE, 0xF };
+            if (Pick (4))
+                return boundary [Pick (std::size(boundary))];
+            else
+                return Pick (16);
+        }
+
+        std::uint64_t Value () {
+            switch (Pick (8)) {
+                case 0: return 0;
+                case 1: return ~std::uint64_t (0);
+                case 2: return rng ();
+            }
+            std::uint64_t value = 0;
+            for (auto n = 0u; n != 16; ++n) {
+                value |= Nibble () << (4 * n);
+            }
+            return value;
+        }
+
+        // Shaped
+        //  - registers satisfying levels up to a random one, optionally with a v9.N set on top
+        //    (promotion chain), then with a few nibbles broken
+        //
+        Regs Shaped () {
+            Regs regs;
+            if (Pick (2)) {
+                for (auto id : ids) {
+                    regs [id] = 0;
+                }
+            }
+            auto strictness = Pick ((std::size_t) AArch64::Strictness::Count);
+            auto top = Pick (10); // 0x801 .. 0x809 and 0x900
+            for (std::size_t i = 0; i != std::size (AArch64::Levels); ++i) {
+                const auto & level = AArch64::Levels [i];
+                if (i < top || (level.name >= 0x900 && Pick (3) == 0)) {
+                    for (std::size_t s = 0; s <= strictness; ++s) {
+                        for (const auto & feature : level.features [s]) {
+                            Raise (regs, feature);
+                        }
+                    }
+                }
+            }
+            for (auto n = Pick (4); n; --n) {
+                const auto & feature = AArch64::Features::All [Pick (std::size (AArch64::Features::All))];
+                auto & value = regs [feature.reg];
+                value &= ~(std::uint64_t (0xF) << feature.offset);
+                value |= std::uint64_t (Pick (2) ? 0xF : (feature.minimum ? feature.minimum - 1 : 0)) << feature.offset;
+            }
+            return regs;
+        }
+
+        Regs Random () {
+            Regs regs;
+            for (auto id : ids) {
+                if (Pick (8)) {
+                    regs [id] = Value ();
+                }
+            }
+            return regs;
+        }
+
+    public:
+        explicit Generator (std::uint64_t seed) : rng (seed) {}
+
+        Dataset Next () {
+            Dataset data;
+            if (Pick (64) == 0)
+                return data;
+
+            // a few distinct classes, spread over processors, like heterogeneous SoCs
+
+            Regs classes [3];
+            auto n = 1 + Pick (std::size (classes));
+            for (auto i = 0u; i != n; ++i) {
+                switch (Pick (8)) {
+                    case 0: break; // empty
+                    case 1:
+                    case 2:
+                    case 3: classes [i] = Random (); break;
+                    default: classes [i] = Shaped (); break;
+                }
+            }
+
+            data.resize (1 + Pick (12));
+            for (auto & regs : data) {
+                regs = classes [Pick (n)];
+            }
+            return data;
+        }
+    };
+
+    // Compare
+    //  - evaluates dataset through engine and reference, returns description of first divergence
+    //
+    std::string Compare (const Dataset & data, std::uint64_t & evaluations) {
+        char text [256];
+        AArch64::Initialize (data);
+
+        for (UINT p = 0; p <= data.size (); ++p) { // including one out of range
+
+            for (const auto & feature : AArch64::Features::All) {
+                if (AArch64::Check (p, feature) != Reference::Check (data, p, feature)) {
+                    std::snprintf (text, sizeof text, "Check (%u, %s)", p, feature.name);
+                    return text;
+                }
+            }
+            if (AArch64::Check (p, AArch64::Features::Null) != Reference::Check (data, p, AArch64::Features::Null)) {
+                std::snprintf (text, sizeof text, "Check (%u, Null)", p);
+                return text;
+            }
+            evaluations += std::size (AArch64::Features::All) + 1;
+
+            for (std::size_t s = 0; s != (std::size_t) AArch64::Strictness::Count; ++s) {
+                if (p < data.size ()) {
+                    for (const auto & level : AArch64::Levels) {
+                        if (ValidateLevel (level, data [p], (AArch64::Strictness) s) != Reference::Validate (data, p, level, (AArch64::Strictness) s)) {
+                            std::snprintf (text, sizeof text, "ValidateLevel (%X, %u, %zu)", level.name, p, s);
+                            return text;
+                        }
+                    }
+                }
+                auto engine = AArch64::Determine (p, (AArch64::Strictness) s);
+                auto reference = Reference::Determine (data, p, (AArch64::Strictness) s);
+                if (engine != reference) {
+                    std::snprintf (text, sizeof text, "Determine (%u, %zu) = %X, reference %X", p, s, engine, reference);
+                    return text;
+                }
+                evaluations += std::size (AArch64::Levels) + 1;
+            }
+        }
+
+        auto intersection = AArch64::Intersect ();
+        auto common = Reference::Common (data);
+
+        if (intersection.common != common)
+            return "Intersect common registers";
+
+        for (std::size_t s = 0; s != (std::size_t) AArch64::Strictness::Count; ++s) {
+            WORD reference = Reference::Any (data) ? Reference::Match ({ common }, 0, (AArch64::Strictness) s) : 0;
+            if (intersection.level [s] != reference) {
+                std::snprintf (text, sizeof text, "Intersect level (%zu) = %X, reference %X", s, intersection.level [s], reference);
+                return text;
+            }
+        }
+
+        std::size_t features = 0;
+        std::size_t partial = 0;
+        for (const auto & feature : AArch64::Features::All) {
+            bool all = !data.empty ();
+            bool any = false;
+            for (UINT p = 0; p != data.size (); ++p) {
+                all &= Reference::Check (data, p, feature);
+                any |= Reference::Check (data, p, feature);
+            }
+            if (all) {
+                if (features >= intersection.features.size () || intersection.features [features++] != feature) {
+                    std::snprintf (text, sizeof text, "Intersect features, %s", feature.name);
+                    return text;
+                }
+            } else
+            if (any) {
+                if (partial >= intersection.partial.size () || intersection.partial [partial++] != feature) {
+                    std::snprintf (text, sizeof text, "Intersect partial, %s", feature.name);
+                    return text;
+                }
+            }
+        }
+        if (features != intersection.features.size () || partial != intersection.partial.size ())
+            return "Intersect features count";
+
+        if (intersection.differences != Reference::Differences (data))
+            return "Intersect differences";
+
+        evaluations += std::size (AArch64::Features::All) + (std::size_t) AArch64::Strictness::Count;
+        return {};
+    }
+
+    // Minimize
+    //  - greedily drops processors, registers and nibbles while the divergence persists
+    //
+    Dataset Minimize (Dataset data) {
+        std::uint64_t ignored = 0;
+        auto fails = [&ignored] (const Dataset & candidate) {
+            return !Compare (candidate, ignored).empty ();
+        };
+
+        bool progress;
+        do {
+            progress = false;
+
+            for (std::size_t p = 0; p < data.size () && data.size () > 1; ) {
+                auto candidate = data;
+                candidate.erase (candidate.begin () + p);
+                if (fails (candidate)) {
+                    data = std::move (candidate);
+                    progress = true;
+                } else {
+                    ++p;
+                }
+            }
+            for (std::size_t p = 0; p != data.size (); ++p) {
+                for (auto id : ids) {
+                    if (data [p].count (id)) {
+                        auto candidate = data;
+                        candidate [p].erase (id);
+                        if (fails (candidate)) {
+                            data = std::move (candidate);
+                            progress = true;
+                        }
+                    }
+                }
+                for (auto & [id, value] : data [p]) {
+                    for (auto n = 0u; n != 16; ++n) {
+                        auto mask = std::uint64_t (0xF) << (4 * n);
+                        if (value & mask) {
+                            auto candidate = data;
+                            candidate [p][id] &= ~mask;
+                            if (fails (candidate)) {
+                                value &= ~mask;
+                                progress = true;
+                            }
+                        }
+                    }
+                }
+            }
+        } while (progress);
+
+        return data;
+    }
+
+    void Dump (const Dataset & data) {
+        std::printf ("std::vector <std::map <std::uint16_t, std::uint64_t>> SnapshotReproducer = {\n");
+        for (const auto & regs : data) {
+            std::printf ("    {\n");
+            for (const auto & [id, value] : regs) {
+                std::printf ("       { 0x%04X, 0x%llx },\n", id, (unsigned long long) value);
+            }
+            std::printf ("    },\n");
+        }
+        std::printf ("};\n");
+    }
+}
+
+int main (int argc, char ** argv) {
+    std::uint64_t count = (argc > 1) ? std::strtoull (argv [1], nullptr, 0) : 100000;
+    std::uint64_t seed = (argc > 2) ? std::strtoull (argv [2], nullptr, 0) : 1;
+
+    std::uint64_t evaluations = 0;
+
+    // regression: v9.0 promoted from v8.5 is not a superset of v8.6, common level is v8.5
+
+    Dataset promoted = {
+        Satisfying ({ 0x801, 0x802, 0x803, 0x804, 0x805, 0x900 }),
+        Satisfying ({ 0x801, 0x802, 0x803, 0x804, 0x805, 0x806 }),
+    };
+    auto divergence = Compare (promoted, evaluations);
+    if (!divergence.empty ()) {
+        std::printf ("promotion regression diverges: %s\n", divergence.c_str ());
+        Dump (promoted);
+        return 1;
+    }
+    auto intersection = AArch64::Intersect ();
+    for (std::size_t s = 0; s != (std::size_t) AArch64::Strictness::Count; ++s) {
+        if (AArch64::Determine (0, (AArch64::Strictness) s) != 0x900
+                || AArch64::Determine (1, (AArch64::Strictness) s) != 0x806
+                || intersection.level [s] != 0x805) {
+            std::printf ("promotion regression: common level (%zu) %X, expected 805\n", s, intersection.level [s]);
+            return 1;
+        }
+    }
+
+    Generator generator (seed);
+
+    auto t0 = std::chrono::steady_clock::now ();
+    for (std::uint64_t i = 0; i != count; ++i) {
+        auto data = generator.Next ();
+        divergence = Compare (data, evaluations);
+        if (!divergence.empty ()) {
+            std::printf ("dataset %llu (seed %llu) diverges: %s\n\n", (unsigned long long) i, (unsigned long long) seed, divergence.c_str ());
+
+            data = Minimize (data);
+            std::uint64_t ignored = 0;
+            std::printf ("minimized, diverges: %s\n", Compare (data, ignored).c_str ());
+            Dump (data);
+            return 1;
+        }
+    }
+    auto seconds = std::chrono::duration <double> (std::chrono::steady_clock::now () - t0).count ();
+
+    std::printf ("%llu datasets, %llu evaluations in %.2f s, %.0f evaluations/s\n",
+                 (unsigned long long) count, (unsigned long long) evaluations, seconds, evaluations / seconds);
+    return 0;
+}
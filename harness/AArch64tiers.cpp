@@ -0,0 +1,147 @@
+// AArch64tiers
+//  - checks tiered 'Resolve' logic on any platform, using mock OS feature sources
+//
+// the engine translation unit is included directly, so that the 'Infer' rules are tested too
+
+#include "../AArch64check.cpp"
+
+#include <cstdio>
+
+namespace {
+    typedef std::map <std::uint16_t, std::uint64_t> Regs;
+
+    int failures = 0;
+
+    void Test (bool condition, const char * description) {
+        if (!condition) {
+            std::printf ("FAILED: %s\n", description);
+            ++failures;
+        }
+    }
+
+    void Expect (AArch64::Resolution r, bool result, AArch64::Tier tier, bool conflict, const char * description) {
+        Test (r.result == result && r.tier == tier && r.conflict == conflict, description);
+    }
+
+    // Satisfy
+    //  - raises register fields in 'regs' to pass all features of the level at given strictness
+    //
+    void Satisfy (Regs & regs, WORD name, AArch64::Strictness strictness) {
+        for (std::size_t s = 0; s <= (std::size_t) strictness; ++s) {
+            for (const auto & feature : GetLevel (name).features [s]) {
+                if (feature.raw != 0) {
+                    auto & value = regs [feature.reg];
+                    auto nibble = (value >> feature.offset) & 0xF;
+                    if (nibble < feature.minimum) {
+                        value &= ~(std::uint64_t (0xF) << feature.offset);
+                        value |= std::uint64_t (feature.minimum) << feature.offset;
+                    }
+                }
+            }
+        }
+    }
+
+    // mock OS feature sources
+
+    const DWORD build = 22000; // mock OS build
+
+    const struct {
+        AArch64::Feature feature;
+        bool             present;
+        bool             exclusive;
+        DWORD            since;
+    } flags [] = {
+        { AArch64::Features::LSE,     true,  true,  0 },
+        { AArch64::Features::DotProd, false, true,  0 },
+        { AArch64::Features::LRCPC,   false, true,  0 },
+        { AArch64::Features::SHA512,  true,  true,  0 },
+        { AArch64::Features::AES,     false, false, 0 },     // combined flag, like PF_ARM_V8_CRYPTO_INSTRUCTIONS_AVAILABLE
+        { AArch64::Features::JSCVT,   false, true,  22621 }, // flag unknown to this OS build
+    };
+
+    // MockFlags
+    //  - same rules as the default Windows source
+    //
+    int MockFlags (AArch64::Feature feature) {
+        return Infer (flags, feature, [] (const auto & flag) {
+            if (flag.present)
+                return 1;
+            else
+                return (flag.exclusive && build >= flag.since) ? 0 : -1;
+        });
+    }
+
+    int MockUnknown (AArch64::Feature) {
+        return -1;
+    }
+
+    int MockAllButBF16 (AArch64::Feature feature) {
+        if (feature.reg == AArch64::Features::BF16.reg && feature.offset == AArch64::Features::BF16.offset)
+            return 0;
+        return 1;
+    }
+}
+
+int main () {
+    const auto Minimal = AArch64::Strictness::Minimal;
+
+    // no register data
+
+    AArch64::Initialize ({});
+    AArch64::SetFeatureSource (MockFlags);
+
+    Expect (AArch64::Resolve (0, AArch64::Features::LSE), true, AArch64::Tier::System, false, "System tier positive");
+    Expect (AArch64::Resolve (0, AArch64::Features::DotProd), false, AArch64::Tier::System, false, "System tier negative");
+    Expect (AArch64::Resolve (0, AArch64::Features::LRCPC2), false, AArch64::Tier::System, false, "LRCPC absent implies LRCPC2 absent");
+    Expect (AArch64::Resolve (0, AArch64::Features::SHA256), true, AArch64::Tier::System, false, "SHA512 present implies SHA256 present");
+    Expect (AArch64::Resolve (0, AArch64::Features::LSE128), false, AArch64::Tier::None, false, "LSE present doesn't decide LSE128");
+    Expect (AArch64::Resolve (0, AArch64::Features::AES), false, AArch64::Tier::None, false, "combined flag off doesn't decide AES");
+    Expect (AArch64::Resolve (0, AArch64::Features::JSCVT), false, AArch64::Tier::None, false, "flag unknown to OS doesn't decide JSCVT");
+    Expect (AArch64::Resolve (0, AArch64::Features::RNG), false, AArch64::Tier::None, false, "unreported feature without register data is Tier::None");
+    Expect (AArch64::Resolve (0, AArch64::Features::Null), true, AArch64::Tier::System, false, "Null is always present");
+    Expect (AArch64::Resolve (0, 0x803, Minimal), false, AArch64::Tier::System, false, "missing LRCPC decides below v8.3");
+    Expect (AArch64::Resolve (0, 0x802, Minimal), false, AArch64::Tier::None, false, "unreported PAN leaves v8.2 undecided");
+
+    AArch64::SetFeatureSource (MockAllButBF16);
+    Expect (AArch64::Resolve (0, 0x806, Minimal), false, AArch64::Tier::None, false, "missing BF16 (v8.6) doesn't decide v8.6, v8.5 can promote to v9.0");
+    Expect (AArch64::Resolve (0, 0x900, Minimal), false, AArch64::Tier::None, false, "missing BF16 (v8.6) doesn't decide v9.0");
+    Expect (AArch64::Resolve (0, 0x805, Minimal), true, AArch64::Tier::System, false, "all flags present decide v8.5");
+
+    // register data: processor 0 is v8.5 + v9.0 set (promoted to v9.0), processor 1 has no LSE
+
+    std::vector <Regs> data (2);
+    for (WORD level : { 0x801, 0x802, 0x803, 0x804, 0x805, 0x900 }) {
+        Satisfy (data [0], level, Minimal);
+    }
+    data [1] = data [0];
+    data [1][AArch64::Features::LSE.reg] &= ~(std::uint64_t (0xF) << AArch64::Features::LSE.offset);
+
+    AArch64::Initialize (data);
+    Test (AArch64::Determine (0, Minimal) == 0x900, "dataset promotes to v9.0");
+
+    AArch64::SetFeatureSource (MockAllButBF16);
+    Expect (AArch64::Resolve (0, 0x900, Minimal), true, AArch64::Tier::Registers, false, "undecided v9.0 falls back to registers");
+    Expect (AArch64::Resolve (0, 0x806, Minimal), true, AArch64::Tier::Registers, false, "v9.0 via promotion is at least v8.6");
+
+    AArch64::SetFeatureSource (MockUnknown);
+    Expect (AArch64::Resolve (0, AArch64::Features::LSE), true, AArch64::Tier::Registers, false, "Registers tier positive");
+    Expect (AArch64::Resolve (1, AArch64::Features::LSE), false, AArch64::Tier::Registers, false, "Registers tier negative");
+    Expect (AArch64::Resolve (0, 0x805, Minimal), true, AArch64::Tier::Registers, false, "Registers tier level");
+    Expect (AArch64::Resolve (2, AArch64::Features::LSE), false, AArch64::Tier::None, false, "processor without data is Tier::None");
+
+    AArch64::SetFeatureSource (MockFlags);
+    Expect (AArch64::Resolve (0, AArch64::Features::LSE), true, AArch64::Tier::System, false, "flags agree with registers");
+    Expect (AArch64::Resolve (1, AArch64::Features::LSE), true, AArch64::Tier::System, true, "flags disagree with registers");
+    Expect (AArch64::Resolve (0, AArch64::Features::DotProd), false, AArch64::Tier::System, true, "flags disagree with registers (negative)");
+    Expect (AArch64::Resolve (0, 0x803, Minimal), false, AArch64::Tier::System, true, "flags disagree with registers on level");
+
+    AArch64::SetFeatureSource (nullptr);
+
+    if (failures) {
+        std::printf ("%d failures\n", failures);
+        return 1;
+    } else {
+        std::printf ("all passed\n");
+        return 0;
+    }
+}
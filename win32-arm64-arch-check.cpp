@@ -126,7 +126,7 @@ int main () {
         for (UINT cpu_set = 0u; cpu_set != sets.size (); ++cpu_set) {
             std::printf ("CPUs %u..%u ISA Level:\n", first, sets [cpu_set] - 1);
 
-            auto processor = 0u;
+            auto processor = first;
             if (auto result = AArch64::Determine (processor, AArch64::Strictness::Strict)) {
                 std::printf ("  Strict:  ARMv%u.%u\n", HIBYTE (result), LOBYTE (result));
 
@@ -182,6 +182,30 @@ int main () {
 
             first = sets [cpu_set];
         }
+
+        if (AArch64::Heterogeneity () > 1) {
+            auto common = AArch64::Intersect ();
+
+            std::printf ("All CPUs common ISA Level:\n");
+            std::printf ("  Strict:  ARMv%u.%u\n", HIBYTE (common.level [(std::size_t) AArch64::Strictness::Strict]), LOBYTE (common.level [(std::size_t) AArch64::Strictness::Strict]));
+            std::printf ("  Relaxed: ARMv%u.%u\n", HIBYTE (common.level [(std::size_t) AArch64::Strictness::Relaxed]), LOBYTE (common.level [(std::size_t) AArch64::Strictness::Relaxed]));
+            std::printf ("  Minimal: ARMv%u.%u\n", HIBYTE (common.level [(std::size_t) AArch64::Strictness::Minimal]), LOBYTE (common.level [(std::size_t) AArch64::Strictness::Minimal]));
+
+            if (!common.partial.empty ()) {
+                std::printf ("\n  Not present on all CPUs:");
+                for (const auto & feature : common.partial) {
+                    DisplayFeatureName (feature, false);
+                }
+                std::printf ("\n");
+            }
+            if (!common.differences.empty ()) {
+                std::printf ("\n  Differing register fields:\n");
+                for (const auto & [id, mask] : common.differences) {
+                    std::printf ("    CP %04X: %016llX\n", id, (unsigned long long) mask);
+                }
+            }
+            std::printf ("\n");
+        }
     } else {
         std::printf ("AArch64::Initialize failed, ERROR (%lu)\n", GetLastError ());
     }